@@ -25,7 +25,6 @@ SOFTWARE.
 #ifndef ASSOCIATIVE_ARRAY_H
 #define ASSOCIATIVE_ARRAY_H
 
-#include "bitstring.h"
 #include "stdbool.h"
 #include "stddef.h"
 #include "stdint.h"
@@ -36,6 +35,13 @@ SOFTWARE.
 #include "stdbool.h"
 #include "stdlib.h"
 
+/**
+ * @brief The largest capacity a map can have. Beyond it the size of the bucket
+ * array does not fit into size_t.
+ *
+ */
+#define ASA_MAX_CAPACITY (SIZE_MAX / sizeof(asa_unit_t))
+
 /**
  * @brief Creates a simple comperator function which expects two pointer to
  * type types. Only integer types are supported.
@@ -97,8 +103,67 @@ typedef enum asa_err_t {
    *
    */
   ASA_DUPLICATE_KEY = -5,
+  /**
+   * @brief The requested capacity is larger than ASA_MAX_CAPACITY.
+   *
+   */
+  ASA_CAPACITY_TOO_LARGE = -6,
+  /**
+   * @brief The function does not support this kind of map, e.g. a multimap
+   * where only plain maps are allowed.
+   *
+   */
+  ASA_WRONG_MAP_TYPE = -7,
 } asa_err_t;
 
+/**
+ * @brief Decides what asa_merge() does with keys that exist in both maps.
+ *
+ */
+typedef enum asa_merge_policy_t {
+  /**
+   * @brief Keep the value that is already stored in the destination map.
+   *
+   */
+  ASA_MERGE_KEEP = 0,
+  /**
+   * @brief Replace the destination value with the value from the source map.
+   *
+   */
+  ASA_MERGE_OVERWRITE = 1,
+} asa_merge_policy_t;
+
+/**
+ * @brief Tells a asa_diff_f callback how a key differs between two maps.
+ *
+ */
+typedef enum asa_diff_kind_t {
+  /**
+   * @brief The key is only in the first map.
+   *
+   */
+  ASA_DIFF_ONLY_IN_A = 0,
+  /**
+   * @brief The key is only in the second map.
+   *
+   */
+  ASA_DIFF_ONLY_IN_B = 1,
+  /**
+   * @brief The key is in both maps but the value pointers differ.
+   *
+   */
+  ASA_DIFF_CHANGED = 2,
+} asa_diff_kind_t;
+
+/**
+ * @brief Definition of the callback used by asa_diff(). The value of the map
+ * that does not contain the key is NULL.
+ *
+ * @return typedef
+ */
+typedef void asa_diff_f(const void *key, void *a_value, void *b_value,
+                        asa_diff_kind_t kind, void *context);
+
 /**
  * @brief Compound type to hold the key and value pointer.
  *
@@ -110,32 +175,114 @@ typedef struct asa_unit_t {
 
 /**
  * @brief Iterator type. Used in conjunction with asa_foreach(). Create it with
- * asa_new_iterator()
+ * asa_new_iterator(). It is -1 when there are no more entries.
  *
  */
-typedef int asa_iterator_t;
+typedef ptrdiff_t asa_iterator_t;
+
+/**
+ * @brief One bit per bucket, e.g. whether the bucket is used.
+ *
+ */
+typedef struct asa_bitmap_t {
+  uint64_t *_words;
+  size_t _length;
+} asa_bitmap_t;
+
+/**
+ * @brief Location of the values of one multimap key inside the value arena.
+ *
+ */
+typedef struct asa_group_t {
+  size_t _offset;
+  size_t _length;
+  size_t _capacity;
+} asa_group_t;
+
+/**
+ * @brief Definition of the callback used by asa_multi_foreach_value().
+ *
+ * @return typedef
+ */
+typedef void asa_value_f(void *value, void *context);
 
 /**
  * @brief Your main handle to an associative array. Create it with
- * asa_create_map()
+ * asa_create_map() or asa_create_multimap()
  *
  */
 typedef struct asa_t {
-  unsigned int _capacity;
+  size_t _capacity;
   asa_unit_t *_buckets;
-  bstr_bitstr_t *_used_buckets;
+  asa_bitmap_t _used_buckets;
   asa_cmp_keys_f *_comperator;
+  uint32_t *_hits;
+  asa_bitmap_t _dirty_buckets;
+  size_t _checkpoint_capacity;
+  size_t _min_capacity;
+  asa_group_t *_groups;
+  void **_arena;
+  size_t _arena_length;
+  size_t _arena_capacity;
+  size_t _arena_holes;
 } asa_t;
 
+/**
+ * @brief One changed bucket of a checkpoint delta. See asa_checkpoint_delta()
+ *
+ */
+typedef struct asa_delta_t {
+  size_t _index;
+  bool _used;
+  void *_key;
+  void *_value;
+} asa_delta_t;
+
+/**
+ * @brief Definition of the callback that persists a asa_delta_t. Key and value
+ * are the pointers stored in the map, so the writer has to serialize what
+ * they point to.
+ *
+ * @return typedef Anything but ASA_NONE aborts the checkpoint.
+ */
+typedef asa_err_t asa_delta_writer_f(const asa_delta_t *delta, void *context);
+
+/**
+ * @brief Definition of the callback that loads the next asa_delta_t.
+ *
+ * @return typedef false when there are no more deltas
+ */
+typedef bool asa_delta_reader_f(asa_delta_t *delta, void *context);
+
 /**
  * @brief Creates a new associative array object.
  *
- * @param capacity How many entries you want to save.
+ * @param capacity How many entries you want to save. At most
+ * ASA_MAX_CAPACITY. When built with
+ * ASA_HUGE_PAGES on Linux, large bucket arrays are backed by transparent huge
+ * pages if the kernel allows it.
  * @param comperator Pointer to your comperator function. See asa_cmp_keys_f
  * @return asa_t* Pointer to your freshly generated array. NULL on allocation
- * failure.
+ * failure or when capacity is larger than ASA_MAX_CAPACITY.
  */
-asa_t *asa_create_map(unsigned int capacity, asa_cmp_keys_f *comperator)
+asa_t *asa_create_map(size_t capacity, asa_cmp_keys_f *comperator)
+    __attribute__((warn_unused_result, nonnull(2)));
+
+/**
+ * @brief Creates a new multimap. It works like a map created with
+ * asa_create_map(), but every key can hold several values which you add with
+ * asa_multi_insert(). The values of one key are stored next to each other in
+ * a value arena shared by all keys. asa_insert(), asa_upsert(), asa_update(),
+ * asa_merge(), asa_diff(), asa_intersect(), asa_upsert_many(),
+ * asa_checkpoint_delta() and asa_replay_delta() reject multimaps with
+ * ASA_WRONG_MAP_TYPE, and asa_get_value_by_key() returns NULL for them.
+ *
+ * @param capacity How many keys you want to save.
+ * @param comperator Pointer to your comperator function. See asa_cmp_keys_f
+ * @return asa_t* Pointer to your freshly generated multimap. NULL on
+ * allocation failure.
+ */
+asa_t *asa_create_multimap(size_t capacity, asa_cmp_keys_f *comperator)
     __attribute__((warn_unused_result, nonnull(2)));
 
 /**
@@ -149,7 +296,8 @@ void asa_delete_map(asa_t *map) __attribute__((nonnull(1)));
  * @brief Insert a key/value pair into the array.
  *
  * @return asa_err_t Returns ASA_DUPLICATE_KEY when the key is already there.
- * ASA_NO_SPACE_LEFT when no bucket is available. ASA_NONE on success.
+ * ASA_NO_SPACE_LEFT when no bucket is available. ASA_WRONG_MAP_TYPE when map
+ * is a multimap. ASA_NONE on success.
  */
 asa_err_t asa_insert(asa_t *const map, void *const key, void *const value)
     __attribute__((warn_unused_result, nonnull(1)));
@@ -158,7 +306,7 @@ asa_err_t asa_insert(asa_t *const map, void *const key, void *const value)
  * @brief This function inserts a key/value pair if the key is not in the array.
  * It will update the values of a existing key.
  *
- * @return asa_err_t
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when map is a multimap.
  */
 asa_err_t asa_upsert(asa_t *const map, void *const key, void *const value)
     __attribute__((warn_unused_result, nonnull(1)));
@@ -167,7 +315,7 @@ asa_err_t asa_upsert(asa_t *const map, void *const key, void *const value)
  * @brief This method will update a value referenced by the key. If the key is
  * not found ASA_KEY_NOT_FOUND is returned.
  *
- * @returns asa_err_t
+ * @returns asa_err_t ASA_WRONG_MAP_TYPE when map is a multimap.
  */
 asa_err_t asa_update(asa_t *const map, const void *const key, void *const value)
     __attribute__((warn_unused_result, nonnull(1)));
@@ -181,7 +329,8 @@ asa_err_t asa_remove(asa_t *const map, const void *const key)
     __attribute__((nonnull(1)));
 
 /**
- * @brief Tells you whether a key exits or not.
+ * @brief Tells you whether a key exits or not. In adaptive mode this counts a
+ * hit, so it writes to the map. See asa_set_adaptive()
  *
  * @return bool True when key exists
  */
@@ -206,27 +355,29 @@ asa_err_t asa_shrink_to_fit(asa_t *const map)
 /**
  * @brief Reserve space for later use
  *
+ * @return asa_err_t ASA_CAPACITY_TOO_LARGE when capacity is larger than
+ * ASA_MAX_CAPACITY.
  */
-asa_err_t asa_reserve_space(asa_t *const map, unsigned int capacity)
+asa_err_t asa_reserve_space(asa_t *const map, size_t capacity)
     __attribute__((warn_unused_result, nonnull(1)));
 
 /**
  * @brief Returns how many buckets this array consists of.
  *
  */
-unsigned int asa_get_capacity(const asa_t *const map)
-    __attribute__((nonnull(1)));
+size_t asa_get_capacity(const asa_t *const map) __attribute__((nonnull(1)));
 
 /**
  * @brief Returns how many buckets are filled
  *
  */
-unsigned int asa_get_length(const asa_t *const map) __attribute__((nonnull(1)));
+size_t asa_get_length(const asa_t *const map) __attribute__((nonnull(1)));
 
 /**
- * @brief Returns a value to a given key
+ * @brief Returns a value to a given key. In adaptive mode this counts a hit,
+ * so it writes to the map. See asa_set_adaptive()
  *
- * @return void* NULL when nothing found
+ * @return void* NULL when nothing found or map is a multimap
  *
  */
 void *asa_get_value_by_key(const asa_t *const map, const void *const key)
@@ -247,4 +398,179 @@ asa_iterator_t asa_new_iterator(const asa_t *const map)
 asa_iterator_t asa_foreach(const asa_t *const map, void **key, void **value,
                            asa_iterator_t offset) __attribute__((nonnull(1)));
 
+/**
+ * @brief Copies all key/value pairs of src into dst. Both maps are sorted once
+ * and joined, so this runs in O(n log n) comparator calls instead of one
+ * lookup per key. dst grows at most once. Both maps have to use the same
+ * comperator.
+ *
+ * @param policy What to do with keys that are in both maps. See
+ * asa_merge_policy_t
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when one of the maps is a multimap.
+ * ASA_MALLOC_FAILED when the scratch memory or the growth of dst could not be
+ * allocated. ASA_NONE on success.
+ */
+asa_err_t asa_merge(asa_t *const dst, const asa_t *const src,
+                    asa_merge_policy_t policy)
+    __attribute__((warn_unused_result, nonnull(1, 2)));
+
+/**
+ * @brief Calls callback for every key that is only in a, only in b, or whose
+ * value pointer differs between a and b. Keys are reported in comperator
+ * order. Both maps have to use the same comperator.
+ *
+ * @param context Passed through to the callback untouched.
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when one of the maps is a multimap.
+ * ASA_MALLOC_FAILED when the scratch memory could not be allocated. ASA_NONE
+ * on success.
+ */
+asa_err_t asa_diff(const asa_t *const a, const asa_t *const b,
+                   asa_diff_f *callback, void *context)
+    __attribute__((warn_unused_result, nonnull(1, 2, 3)));
+
+/**
+ * @brief Inserts every key that is in a and in b into out, using the values
+ * of a. Existing values of out are overwritten. out must be a different map
+ * than a and b. All maps have to use the same comperator.
+ *
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when one of the maps is a multimap.
+ * ASA_MALLOC_FAILED when the scratch memory or the growth of out could not be
+ * allocated. ASA_NONE on success.
+ */
+asa_err_t asa_intersect(const asa_t *const a, const asa_t *const b,
+                        asa_t *const out)
+    __attribute__((warn_unused_result, nonnull(1, 2, 3)));
+
+/**
+ * @brief Upserts n key/value pairs at once. Only the batch is sorted. A single
+ * pass over the used buckets then binary searches every stored key in the
+ * batch, so the cost is O(m log n + n log n) comparator calls for a map with m
+ * entries and a batch of n keys. The map grows at most once for all new keys.
+ * When a key occurs several times in the batch the last value wins, just like
+ * calling asa_upsert() in order.
+ *
+ * @param results Optional array of n entries that receives the outcome for
+ * every key. May be NULL.
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when map is a multimap.
+ * ASA_MALLOC_FAILED when the scratch memory or the growth of the map could
+ * not be allocated. When the growth fails, keys that were already in the map
+ * have been updated anyway and only the new keys report the error in results.
+ * ASA_NONE on success.
+ */
+asa_err_t asa_upsert_many(asa_t *const map, void *const *keys,
+                          void *const *values, size_t n, asa_err_t *results)
+    __attribute__((warn_unused_result, nonnull(1)));
+
+/**
+ * @brief Removes n keys at once in a single pass over the map.
+ *
+ * @param results Optional array of n entries that receives ASA_NONE for every
+ * removed key and ASA_KEY_NOT_FOUND for every key that was not there. May be
+ * NULL.
+ * @return asa_err_t ASA_MALLOC_FAILED when the scratch memory could not be
+ * allocated. ASA_NONE otherwise.
+ */
+asa_err_t asa_remove_many(asa_t *const map, const void *const *keys,
+                          size_t n, asa_err_t *results)
+    __attribute__((nonnull(1)));
+
+/**
+ * @brief Enables or disables the adaptive mode. In adaptive mode every
+ * lookup through asa_key_exists(), asa_get_value_by_key(), asa_update(),
+ * asa_upsert(), asa_multi_insert(), asa_multi_foreach_value() or
+ * asa_multi_count() counts a hit for the found bucket, and asa_reorder() moves
+ * frequently used keys to the front where lookups find them first. The const
+ * lookups then write to the map, so concurrent readers need a lock.
+ *
+ * @return asa_err_t ASA_MALLOC_FAILED when the hit counters could not be
+ * allocated. ASA_NONE on success.
+ */
+asa_err_t asa_set_adaptive(asa_t *const map, bool enabled)
+    __attribute__((warn_unused_result, nonnull(1)));
+
+/**
+ * @brief Moves all entries to the front of the array, ordered by their hit
+ * count, and halves all hit counts so old popularity fades. Call this
+ * periodically. It does nothing when the adaptive mode is disabled.
+ * Iterators are invalidated.
+ *
+ * @return asa_err_t ASA_MALLOC_FAILED when the scratch memory could not be
+ * allocated. ASA_NONE on success.
+ */
+asa_err_t asa_reorder(asa_t *const map)
+    __attribute__((warn_unused_result, nonnull(1)));
+
+/**
+ * @brief Returns how many keys a lookup compares on average. In adaptive mode
+ * every entry is weighted by its hit count, otherwise all entries count the
+ * same.
+ *
+ * @return double 0 when the map is empty
+ */
+double asa_get_average_probe_depth(const asa_t *const map)
+    __attribute__((nonnull(1)));
+
+/**
+ * @brief Passes every bucket that was inserted, updated or removed since the
+ * last checkpoint to writer and marks all buckets clean again. The first
+ * checkpoint of a map contains all its entries. When the writer fails the
+ * buckets stay dirty, so the next checkpoint repeats them.
+ *
+ * @param context Passed through to the writer untouched.
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when map is a multimap, because the
+ * values of a multimap are not part of a delta. The error of the writer.
+ * ASA_NONE on success.
+ */
+asa_err_t asa_checkpoint_delta(asa_t *const map, asa_delta_writer_f *writer,
+                               void *context)
+    __attribute__((warn_unused_result, nonnull(1, 2)));
+
+/**
+ * @brief Applies deltas written by asa_checkpoint_delta() to map until reader
+ * returns false. Replay all checkpoints in the order they were written into
+ * an initially empty map. The map grows when a delta needs more buckets.
+ *
+ * @param context Passed through to the reader untouched.
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when map is a multimap.
+ * ASA_MALLOC_FAILED when the map could not grow. ASA_NONE on success.
+ */
+asa_err_t asa_replay_delta(asa_t *const map, asa_delta_reader_f *reader,
+                           void *context)
+    __attribute__((warn_unused_result, nonnull(1, 2)));
+
+/**
+ * @brief Appends a value to the values of key. The key is inserted when it is
+ * not there yet. Only use this with maps created by asa_create_multimap().
+ *
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when map is not a multimap.
+ * ASA_NO_SPACE_LEFT when the key is new and no bucket is available.
+ * ASA_MALLOC_FAILED when the value arena could not grow. ASA_NONE on success.
+ */
+asa_err_t asa_multi_insert(asa_t *const map, void *const key,
+                           void *const value)
+    __attribute__((warn_unused_result, nonnull(1)));
+
+/**
+ * @brief Calls callback for every value of key in insertion order. In
+ * adaptive mode this counts a hit, so it writes to the map. See
+ * asa_set_adaptive()
+ *
+ * @param context Passed through to the callback untouched.
+ * @return asa_err_t ASA_WRONG_MAP_TYPE when map is not a multimap.
+ * ASA_KEY_NOT_FOUND when the key is not there. ASA_NONE otherwise.
+ */
+asa_err_t asa_multi_foreach_value(const asa_t *const map,
+                                  const void *const key, asa_value_f *callback,
+                                  void *context)
+    __attribute__((nonnull(1, 3)));
+
+/**
+ * @brief Returns how many values key holds in a multimap. In adaptive mode
+ * this counts a hit, so it writes to the map. See asa_set_adaptive()
+ *
+ * @return size_t 0 when the key is not there or map is not a multimap
+ */
+size_t asa_multi_count(const asa_t *const map, const void *const key)
+    __attribute__((nonnull(1)));
+
 #endif
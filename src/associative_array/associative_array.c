@@ -22,27 +22,139 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#if defined(ASA_HUGE_PAGES) && defined(__linux__)
+#define _DEFAULT_SOURCE
+#include "sys/mman.h"
+#include "unistd.h"
+#endif
+
 #include "associative_array/associative_array.h"
 
-static unsigned int __attribute__((pure))
-_calculate_bitstr_size(unsigned int capacity) {
-  unsigned int size = capacity / (sizeof(unsigned int) * 8);
-  if (capacity % (sizeof(unsigned int) * 8) != 0)
-    size++;
-  return size;
+static size_t __attribute__((pure)) _calculate_bitmap_words(size_t length) {
+  size_t words = length / 64;
+  if (length % 64 != 0)
+    words++;
+  return words;
+}
+
+static asa_err_t _bitmap_resize(asa_bitmap_t *const bitmap, size_t length) {
+  size_t old_words = _calculate_bitmap_words(bitmap->_length);
+  size_t words = _calculate_bitmap_words(length);
+  if (words != old_words || bitmap->_words == NULL) {
+    // An empty bitmap still owns one word, so _words is never NULL.
+    uint64_t *result = (uint64_t *)realloc(
+        bitmap->_words, sizeof(uint64_t) * (words != 0 ? words : 1));
+    if (result == NULL)
+      return ASA_MALLOC_FAILED;
+    if (words > old_words)
+      memset(result + old_words, 0, sizeof(uint64_t) * (words - old_words));
+    bitmap->_words = result;
+  }
+  if (length < bitmap->_length && length % 64 != 0)
+    bitmap->_words[words - 1] &= (UINT64_C(1) << (length % 64)) - 1;
+  bitmap->_length = length;
+  return ASA_NONE;
+}
+
+static void _bitmap_delete(asa_bitmap_t *const bitmap) {
+  free(bitmap->_words);
+}
+
+static void _bitmap_clear_all(asa_bitmap_t *const bitmap) {
+  memset(bitmap->_words, 0,
+         sizeof(uint64_t) * _calculate_bitmap_words(bitmap->_length));
+}
+
+static bool _bitmap_get(const asa_bitmap_t *const bitmap, size_t index) {
+  return (bitmap->_words[index / 64] >> (index % 64)) & 1;
+}
+
+static void _bitmap_set(asa_bitmap_t *const bitmap, size_t index) {
+  bitmap->_words[index / 64] |= UINT64_C(1) << (index % 64);
+}
+
+static void _bitmap_clr(asa_bitmap_t *const bitmap, size_t index) {
+  bitmap->_words[index / 64] &= ~(UINT64_C(1) << (index % 64));
+}
+
+static size_t __attribute__((pure))
+_bitmap_count(const asa_bitmap_t *const bitmap) {
+  size_t count = 0;
+  size_t words = _calculate_bitmap_words(bitmap->_length);
+  for (size_t i = 0; i != words; i++)
+    count += __builtin_popcountll(bitmap->_words[i]);
+  return count;
 }
 
-static asa_unit_t *_get_unit_by_index(const asa_t *const map,
-                                      unsigned int index) {
+// Index of the first bit at or after from that differs from skip, -1 when
+// there is none. skip is 0 to find set bits and all ones to find clear bits.
+static ptrdiff_t _bitmap_find(const asa_bitmap_t *const bitmap, size_t from,
+                              uint64_t skip) {
+  if (from >= bitmap->_length)
+    return -1;
+  size_t words = _calculate_bitmap_words(bitmap->_length);
+  size_t word = from / 64;
+  uint64_t bits = (bitmap->_words[word] ^ skip) & (~UINT64_C(0) << (from % 64));
+  while (bits == 0) {
+    if (++word == words)
+      return -1;
+    bits = bitmap->_words[word] ^ skip;
+  }
+  size_t index = word * 64 + __builtin_ctzll(bits);
+  if (index >= bitmap->_length)
+    return -1;
+  return index;
+}
+
+static ptrdiff_t _bitmap_next_set(const asa_bitmap_t *const bitmap,
+                                  size_t from) {
+  return _bitmap_find(bitmap, from, 0);
+}
+
+static ptrdiff_t _bitmap_next_clear(const asa_bitmap_t *const bitmap,
+                                    size_t from) {
+  return _bitmap_find(bitmap, from, ~UINT64_C(0));
+}
+
+static void _advise_huge_pages(void *memory, size_t size) {
+#if defined(ASA_HUGE_PAGES) && defined(__linux__) && defined(MADV_HUGEPAGE)
+  const uintptr_t huge_page_size = 2 * 1024 * 1024;
+  if (size < huge_page_size)
+    return;
+  uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+  uintptr_t begin = ((uintptr_t)memory + page_size - 1) & ~(page_size - 1);
+  uintptr_t end = ((uintptr_t)memory + size) & ~(page_size - 1);
+  // This is only a hint. Without transparent huge pages we keep the normal
+  // pages.
+  if (end > begin)
+    madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+#else
+  (void)memory;
+  (void)size;
+#endif
+}
+
+static asa_unit_t *_allocate_buckets(asa_unit_t *buckets, size_t capacity) {
+  if (capacity > SIZE_MAX / sizeof(asa_unit_t))
+    return NULL;
+  size_t size = capacity * sizeof(asa_unit_t);
+  asa_unit_t *result = (asa_unit_t *)realloc(buckets, size);
+  if (result != NULL)
+    _advise_huge_pages(result, size);
+  return result;
+}
+
+static asa_unit_t *_get_unit_by_index(const asa_t *const map, size_t index) {
   return map->_buckets + index;
 }
 
-static int _get_index_by_key(const asa_t *const map, const void *const key) {
+static ptrdiff_t _get_index_by_key(const asa_t *const map,
+                                   const void *const key) {
 #ifdef DEBUG
   assert(map != NULL);
 #endif
-  for (unsigned int i = 0; i != map->_capacity; i++) {
-    if (bstr_get(map->_used_buckets, i)) {
+  for (size_t i = 0; i != map->_capacity; i++) {
+    if (_bitmap_get(&map->_used_buckets, i)) {
       asa_unit_t *target = map->_buckets + i;
       if (map->_comperator(key, target->_key) == 0) {
         return i;
@@ -52,19 +164,367 @@ static int _get_index_by_key(const asa_t *const map, const void *const key) {
   return -1;
 }
 
-asa_t *asa_create_map(unsigned int capacity, asa_cmp_keys_f *comperator) {
+// Used by the lookups the caller asks for. In adaptive mode they count a hit
+// for the found bucket, even through a const map.
+static ptrdiff_t _lookup_key(const asa_t *const map, const void *const key) {
+  ptrdiff_t index = _get_index_by_key(map, key);
+  if (index != -1 && map->_hits != NULL && map->_hits[index] != UINT32_MAX)
+    map->_hits[index]++;
+  return index;
+}
+
+static void _set_bucket(asa_t *const map, size_t index, asa_unit_t unit) {
+  map->_buckets[index] = unit;
+  _bitmap_set(&map->_used_buckets, index);
+  _bitmap_set(&map->_dirty_buckets, index);
+}
+
+static void _set_value(asa_t *const map, size_t index, void *const value) {
+  map->_buckets[index]._value = value;
+  _bitmap_set(&map->_dirty_buckets, index);
+}
+
+static void _clear_bucket(asa_t *const map, size_t index) {
+  _bitmap_clr(&map->_used_buckets, index);
+  _bitmap_set(&map->_dirty_buckets, index);
+  memset(map->_buckets + index, 0, sizeof(asa_unit_t));
+  if (map->_hits != NULL)
+    map->_hits[index] = 0;
+  if (map->_groups != NULL) {
+    map->_arena_holes += map->_groups[index]._capacity;
+    memset(map->_groups + index, 0, sizeof(asa_group_t));
+  }
+}
+
+static void _move_bucket(asa_t *const map, size_t from, size_t to) {
+  _set_bucket(map, to, map->_buckets[from]);
+  if (map->_hits != NULL)
+    map->_hits[to] = map->_hits[from];
+  if (map->_groups != NULL) {
+    map->_groups[to] = map->_groups[from];
+    memset(map->_groups + from, 0, sizeof(asa_group_t));
+  }
+  _clear_bucket(map, from);
+}
+
+static void *_resize_bucket_data(void *data, size_t size, size_t old_capacity,
+                                 size_t capacity) {
+  if (capacity >= SIZE_MAX / size)
+    return NULL;
+  char *result = (char *)realloc(data, size * (capacity + 1));
+  if (result == NULL)
+    return NULL;
+  if (capacity > old_capacity)
+    memset(result + size * old_capacity, 0, size * (capacity - old_capacity));
+  return result;
+}
+
+static asa_err_t _resize_metadata(asa_t *const map, size_t capacity) {
+  if (map->_hits != NULL) {
+    uint32_t *hits = (uint32_t *)_resize_bucket_data(
+        map->_hits, sizeof(uint32_t), map->_capacity, capacity);
+    if (hits == NULL)
+      return ASA_MALLOC_FAILED;
+    map->_hits = hits;
+  }
+  if (map->_groups != NULL) {
+    asa_group_t *groups = (asa_group_t *)_resize_bucket_data(
+        map->_groups, sizeof(asa_group_t), map->_capacity, capacity);
+    if (groups == NULL)
+      return ASA_MALLOC_FAILED;
+    map->_groups = groups;
+  }
+  return ASA_NONE;
+}
+
+static asa_err_t _reserve_arena(asa_t *const map, size_t length) {
+  if (map->_arena_capacity - map->_arena_length >= length)
+    return ASA_NONE;
+  if (length > SIZE_MAX / sizeof(void *) / 2 - map->_arena_length)
+    return ASA_MALLOC_FAILED;
+  size_t capacity = map->_arena_capacity * 2;
+  if (capacity < map->_arena_length + length)
+    capacity = map->_arena_length + length;
+  void **arena = (void **)realloc(map->_arena, sizeof(void *) * capacity);
+  if (arena == NULL)
+    return ASA_MALLOC_FAILED;
+  map->_arena = arena;
+  map->_arena_capacity = capacity;
+  return ASA_NONE;
+}
+
+static asa_err_t _compact_arena(asa_t *const map) {
+  size_t length = 0;
+  for (size_t i = 0; i != map->_capacity; i++)
+    length += map->_groups[i]._length;
+  void **arena = (void **)malloc(sizeof(void *) * (length + 1));
+  if (arena == NULL)
+    return ASA_MALLOC_FAILED;
+
+  size_t offset = 0;
+  for (size_t i = 0; i != map->_capacity; i++) {
+    asa_group_t *group = map->_groups + i;
+    if (group->_length != 0)
+      memcpy(arena + offset, map->_arena + group->_offset,
+             sizeof(void *) * group->_length);
+    group->_offset = offset;
+    group->_capacity = group->_length;
+    offset += group->_length;
+  }
+  free(map->_arena);
+  map->_arena = arena;
+  map->_arena_length = length;
+  map->_arena_capacity = length + 1;
+  map->_arena_holes = 0;
+  return ASA_NONE;
+}
+
+static asa_err_t _grow_group(asa_t *const map, size_t index) {
+  asa_group_t *group = map->_groups + index;
+  size_t capacity = group->_capacity == 0 ? 1 : group->_capacity * 2;
+  asa_err_t err;
+  // The last group of the arena can grow in place.
+  if (group->_capacity != 0 &&
+      group->_offset + group->_capacity == map->_arena_length) {
+    err = _reserve_arena(map, capacity - group->_capacity);
+    if (err != ASA_NONE)
+      return err;
+    map->_arena_length += capacity - group->_capacity;
+    group->_capacity = capacity;
+    return ASA_NONE;
+  }
+
+  if (map->_arena_holes > map->_arena_length / 2) {
+    err = _compact_arena(map);
+    if (err != ASA_NONE)
+      return err;
+  }
+  err = _reserve_arena(map, capacity);
+  if (err != ASA_NONE)
+    return err;
+  if (group->_length != 0)
+    memcpy(map->_arena + map->_arena_length, map->_arena + group->_offset,
+           sizeof(void *) * group->_length);
+  map->_arena_holes += group->_capacity;
+  group->_offset = map->_arena_length;
+  group->_capacity = capacity;
+  map->_arena_length += capacity;
+  return ASA_NONE;
+}
+
+static const void *_get_key_at(const void *base, size_t stride, size_t index) {
+  return *(void *const *)((const char *)base + stride * index);
+}
+
+static void _sort_indices(size_t *indices, size_t *scratch, size_t length,
+                          const void *base, size_t stride,
+                          asa_cmp_keys_f *comperator) {
+  size_t *from = indices;
+  size_t *to = scratch;
+  for (size_t width = 1; width < length; width *= 2) {
+    for (size_t low = 0; low < length; low += 2 * width) {
+      size_t mid = low + width < length ? low + width : length;
+      size_t high = mid + width < length ? mid + width : length;
+      size_t left = low;
+      size_t right = mid;
+      for (size_t out = low; out != high; out++) {
+        if (right == high ||
+            (left != mid && comperator(_get_key_at(base, stride, from[left]),
+                                       _get_key_at(base, stride,
+                                                   from[right])) <= 0))
+          to[out] = from[left++];
+        else
+          to[out] = from[right++];
+      }
+    }
+    size_t *tmp = from;
+    from = to;
+    to = tmp;
+  }
+  if (from != indices)
+    memcpy(indices, from, length * sizeof(size_t));
+}
+
+// Counts the used buckets below _capacity. Unlike asa_get_length() this
+// ignores used bits that a shrinking asa_reserve_space() left behind.
+static size_t _count_used_buckets(const asa_t *const map) {
+  size_t count = 0;
+  for (ptrdiff_t i = _bitmap_next_set(&map->_used_buckets, 0); i != -1;
+       i = _bitmap_next_set(&map->_used_buckets, i + 1))
+    count++;
+  return count;
+}
+
+static asa_err_t _get_sorted_indices(const asa_t *const map, size_t **indices,
+                                     size_t *length) {
+  *length = _count_used_buckets(map);
+  *indices = (size_t *)malloc(sizeof(size_t) * (*length + 1));
+  if (*indices == NULL)
+    return ASA_MALLOC_FAILED;
+  size_t *scratch = (size_t *)malloc(sizeof(size_t) * (*length + 1));
+  if (scratch == NULL) {
+    free(*indices);
+    *indices = NULL;
+    return ASA_MALLOC_FAILED;
+  }
+
+  size_t count = 0;
+  for (ptrdiff_t i = _bitmap_next_set(&map->_used_buckets, 0); i != -1;
+       i = _bitmap_next_set(&map->_used_buckets, i + 1))
+    (*indices)[count++] = i;
+  _sort_indices(*indices, scratch, count, &map->_buckets->_key,
+                sizeof(asa_unit_t), map->_comperator);
+  free(scratch);
+  return ASA_NONE;
+}
+
+static asa_err_t _append_units(asa_t *const map, const asa_unit_t *units,
+                               const size_t *indices, size_t length) {
+  if (length == 0)
+    return ASA_NONE;
+  size_t free_buckets = map->_capacity - _count_used_buckets(map);
+  if (length > free_buckets) {
+    asa_err_t err =
+        asa_reserve_space(map, map->_capacity + (length - free_buckets));
+    if (err != ASA_NONE)
+      return err;
+  }
+
+  size_t bucket = 0;
+  for (size_t i = 0; i != length; i++) {
+    while (_bitmap_get(&map->_used_buckets, bucket))
+      bucket++;
+    _set_bucket(map, bucket, units[indices != NULL ? indices[i] : i]);
+  }
+  return ASA_NONE;
+}
+
+static asa_err_t _sort_batch(const void *const *keys, size_t n,
+                             asa_cmp_keys_f *comperator, size_t **order) {
+  *order = (size_t *)malloc(sizeof(size_t) * (n + 1));
+  if (*order == NULL)
+    return ASA_MALLOC_FAILED;
+  size_t *scratch = (size_t *)malloc(sizeof(size_t) * (n + 1));
+  if (scratch == NULL) {
+    free(*order);
+    *order = NULL;
+    return ASA_MALLOC_FAILED;
+  }
+  for (size_t i = 0; i != n; i++)
+    (*order)[i] = i;
+  _sort_indices(*order, scratch, n, keys, sizeof(void *), comperator);
+  free(scratch);
+  return ASA_NONE;
+}
+
+static size_t _get_group_end(const void *const *keys, const size_t *order,
+                             size_t n, size_t begin,
+                             asa_cmp_keys_f *comperator) {
+  size_t end = begin + 1;
+  while (end != n && comperator(keys[order[end]], keys[order[begin]]) == 0)
+    end++;
+  return end;
+}
+
+static asa_err_t _group_batch(const void *const *keys, size_t n,
+                              asa_cmp_keys_f *comperator, size_t **order,
+                              size_t **begins, size_t *groups) {
+  asa_err_t err = _sort_batch(keys, n, comperator, order);
+  if (err != ASA_NONE)
+    return err;
+  *begins = (size_t *)malloc(sizeof(size_t) * (n + 1));
+  if (*begins == NULL) {
+    free(*order);
+    *order = NULL;
+    return ASA_MALLOC_FAILED;
+  }
+
+  size_t count = 0;
+  for (size_t begin = 0, end; begin != n; begin = end) {
+    end = _get_group_end(keys, *order, n, begin, comperator);
+    (*begins)[count++] = begin;
+  }
+  (*begins)[count] = n;
+  *groups = count;
+  return ASA_NONE;
+}
+
+static ptrdiff_t _find_group(const void *const *keys, const size_t *order,
+                             const size_t *begins, size_t groups,
+                             const void *key, asa_cmp_keys_f *comperator) {
+  size_t low = 0;
+  size_t high = groups;
+  while (low != high) {
+    size_t mid = low + (high - low) / 2;
+    int cmp = comperator(key, keys[order[begins[mid]]]);
+    if (cmp == 0)
+      return mid;
+    if (cmp < 0)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return -1;
+}
+
+static asa_err_t _merge_sorted(asa_t *const dst, const asa_t *const src,
+                               size_t *src_indices, size_t src_length,
+                               asa_merge_policy_t policy) {
+  size_t *dst_indices;
+  size_t dst_length;
+  asa_err_t err = _get_sorted_indices(dst, &dst_indices, &dst_length);
+  if (err != ASA_NONE)
+    return err;
+
+  size_t missing = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (j != src_length) {
+    asa_unit_t *src_unit = src->_buckets + src_indices[j];
+    if (i == dst_length) {
+      src_indices[missing++] = src_indices[j++];
+      continue;
+    }
+    asa_unit_t *dst_unit = dst->_buckets + dst_indices[i];
+    int cmp = dst->_comperator(src_unit->_key, dst_unit->_key);
+    if (cmp == 0) {
+      if (policy == ASA_MERGE_OVERWRITE)
+        _set_value(dst, dst_indices[i], src_unit->_value);
+      i++;
+      j++;
+    } else if (cmp < 0) {
+      src_indices[missing++] = src_indices[j++];
+    } else {
+      i++;
+    }
+  }
+  free(dst_indices);
+  return _append_units(dst, src->_buckets, src_indices, missing);
+}
+
+asa_t *asa_create_map(size_t capacity, asa_cmp_keys_f *comperator) {
+  if (capacity > ASA_MAX_CAPACITY)
+    return NULL;
   asa_t *result = (asa_t *)malloc(sizeof(asa_t));
   if (result == NULL)
     return NULL;
 
-  asa_unit_t *buckets = (asa_unit_t *)malloc(sizeof(asa_unit_t) * capacity);
+  asa_unit_t *buckets = _allocate_buckets(NULL, capacity);
   if (buckets == NULL) {
     free(result);
     return NULL;
   }
 
-  bstr_bitstr_t *used = bstr_create_bitstr(_calculate_bitstr_size(capacity));
-  if (used == NULL) {
+  asa_bitmap_t used = {._words = NULL, ._length = 0};
+  if (_bitmap_resize(&used, capacity) != ASA_NONE) {
+    free(buckets);
+    free(result);
+    return NULL;
+  }
+
+  asa_bitmap_t dirty = {._words = NULL, ._length = 0};
+  if (_bitmap_resize(&dirty, capacity) != ASA_NONE) {
+    _bitmap_delete(&used);
     free(buckets);
     free(result);
     return NULL;
@@ -75,6 +535,27 @@ asa_t *asa_create_map(unsigned int capacity, asa_cmp_keys_f *comperator) {
   result->_capacity = capacity;
   result->_buckets = buckets;
   result->_used_buckets = used;
+  result->_hits = NULL;
+  result->_dirty_buckets = dirty;
+  result->_checkpoint_capacity = capacity;
+  result->_min_capacity = capacity;
+  result->_groups = NULL;
+  result->_arena = NULL;
+  result->_arena_length = 0;
+  result->_arena_capacity = 0;
+  result->_arena_holes = 0;
+  return result;
+}
+
+asa_t *asa_create_multimap(size_t capacity, asa_cmp_keys_f *comperator) {
+  asa_t *result = asa_create_map(capacity, comperator);
+  if (result == NULL)
+    return NULL;
+  result->_groups = (asa_group_t *)calloc(capacity + 1, sizeof(asa_group_t));
+  if (result->_groups == NULL) {
+    asa_delete_map(result);
+    return NULL;
+  }
   return result;
 }
 
@@ -83,7 +564,11 @@ void asa_delete_map(asa_t *map) {
   assert(map != NULL);
 #endif
   free(map->_buckets);
-  bstr_delete_bitstr(map->_used_buckets);
+  _bitmap_delete(&map->_used_buckets);
+  _bitmap_delete(&map->_dirty_buckets);
+  free(map->_hits);
+  free(map->_groups);
+  free(map->_arena);
   free(map);
   return;
 }
@@ -92,17 +577,16 @@ asa_err_t asa_insert(asa_t *const map, void *const key, void *const value) {
 #ifdef DEBUG
   assert(map != NULL);
 #endif
-  if (asa_key_exists(map, key))
+  if (map->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  if (_get_index_by_key(map, key) != -1)
     return ASA_DUPLICATE_KEY;
 
-  int free_bucket_index = bstr_ffus(map->_used_buckets);
-  bstr_set(map->_used_buckets, free_bucket_index);
+  ptrdiff_t free_bucket_index = _bitmap_next_clear(&map->_used_buckets, 0);
   if (free_bucket_index == -1)
     return ASA_NO_SPACE_LEFT;
   asa_unit_t entry = {._key = key, ._value = value};
-
-  asa_unit_t *target = map->_buckets + free_bucket_index;
-  *target = entry;
+  _set_bucket(map, free_bucket_index, entry);
   return ASA_NONE;
 }
 
@@ -110,12 +594,13 @@ asa_err_t asa_upsert(asa_t *const map, void *const key, void *const value) {
 #ifdef DEBUG
   assert(map != NULL);
 #endif
-  int index = _get_index_by_key(map, key);
+  if (map->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  ptrdiff_t index = _lookup_key(map, key);
   if (index == -1)
     return asa_insert(map, key, value);
 
-  asa_unit_t *target = _get_unit_by_index(map, index);
-  target->_value = value;
+  _set_value(map, index, value);
   return ASA_NONE;
 }
 
@@ -124,12 +609,13 @@ asa_err_t asa_update(asa_t *const map, const void *const key,
 #ifdef DEBUG
   assert(map != NULL);
 #endif
-  int index = _get_index_by_key(map, key);
+  if (map->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  ptrdiff_t index = _lookup_key(map, key);
   if (index == -1)
     return ASA_KEY_NOT_FOUND;
 
-  asa_unit_t *target = _get_unit_by_index(map, index);
-  target->_value = value;
+  _set_value(map, index, value);
   return ASA_NONE;
 }
 
@@ -138,12 +624,10 @@ asa_err_t asa_remove(asa_t *const map, const void *const key) {
   assert(map != NULL);
   assert(key != NULL);
 #endif
-  int index = _get_index_by_key(map, key);
+  ptrdiff_t index = _get_index_by_key(map, key);
   if (index == -1)
     return ASA_KEY_NOT_FOUND;
-  bstr_clr(map->_used_buckets, index);
-  asa_unit_t *target = map->_buckets + index;
-  memset(target, 0, sizeof(asa_unit_t));
+  _clear_bucket(map, index);
   return ASA_NONE;
 }
 
@@ -153,38 +637,35 @@ bool asa_key_exists(const asa_t *const map, const void *const key) {
   assert(key != NULL);
 #endif
 
-  int index = _get_index_by_key(map, key);
+  ptrdiff_t index = _lookup_key(map, key);
   if (index == -1)
     return false;
   return true;
 }
 
 bool asa_is_empty(const asa_t *const map) {
-  if (bstr_popcnt(map->_used_buckets) == 0)
+  if (_bitmap_count(&map->_used_buckets) == 0)
     return true;
   return false;
 }
 
 asa_err_t asa_shrink_to_fit(asa_t *const map) {
+  if (map->_groups != NULL && _compact_arena(map) != ASA_NONE)
+    return ASA_MALLOC_FAILED;
   if (asa_is_empty(map))
     return ASA_NONE;
-  int used_buckets = bstr_popcnt(map->_used_buckets);
+  size_t used_buckets = asa_get_length(map);
   if (used_buckets == map->_capacity)
     return ASA_NONE;
 
   while (true) {
-    int first_free_bucket = bstr_ffus(map->_used_buckets);
-    if (first_free_bucket == -1 || first_free_bucket >= map->_capacity)
+    ptrdiff_t first_free_bucket = _bitmap_next_clear(&map->_used_buckets, 0);
+    if (first_free_bucket == -1)
       break;
     bool found_used_bucket = false;
-    for (int bit = first_free_bucket; bit != map->_capacity; bit++) {
-      if (bstr_get(map->_used_buckets, bit)) {
-        asa_unit_t *free_bucket = map->_buckets + first_free_bucket;
-        asa_unit_t *used_bucket = map->_buckets + bit;
-        memcpy(free_bucket, used_bucket, sizeof(asa_unit_t));
-        memset(used_bucket, 0, sizeof(asa_unit_t));
-        bstr_set(map->_used_buckets, first_free_bucket);
-        bstr_clr(map->_used_buckets, bit);
+    for (size_t bit = first_free_bucket; bit != map->_capacity; bit++) {
+      if (_bitmap_get(&map->_used_buckets, bit)) {
+        _move_bucket(map, bit, first_free_bucket);
         found_used_bucket = true;
         break;
       }
@@ -192,27 +673,34 @@ asa_err_t asa_shrink_to_fit(asa_t *const map) {
     if (found_used_bucket == false)
       break;
   }
+  if (_resize_metadata(map, used_buckets) != ASA_NONE)
+    return ASA_MALLOC_FAILED;
   map->_capacity = used_buckets;
-  asa_unit_t *new_buckets =
-      (asa_unit_t *)realloc(map->_buckets, map->_capacity * sizeof(asa_unit_t));
+  if (used_buckets < map->_min_capacity)
+    map->_min_capacity = used_buckets;
+  asa_unit_t *new_buckets = _allocate_buckets(map->_buckets, map->_capacity);
   if (new_buckets == NULL)
     return ASA_MALLOC_FAILED;
   map->_buckets = new_buckets;
-  bstr_err_t bstrerr =
-      bstr_resize(map->_used_buckets, _calculate_bitstr_size(used_buckets));
-  if (bstrerr != BSTR_NO_ERROR)
+  if (_bitmap_resize(&map->_used_buckets, used_buckets) != ASA_NONE)
+    return ASA_DATASTRUCTURE_CORRUPTED;
+  if (_bitmap_resize(&map->_dirty_buckets, used_buckets) != ASA_NONE)
     return ASA_DATASTRUCTURE_CORRUPTED;
   return ASA_NONE;
 }
 
-asa_err_t asa_reserve_space(asa_t *const map, unsigned int capacity) {
+asa_err_t asa_reserve_space(asa_t *const map, size_t capacity) {
   if (map->_capacity == capacity)
     return ASA_NONE;
-  asa_unit_t *newMem = realloc(map->_buckets, capacity * sizeof(asa_unit_t));
+  if (capacity > ASA_MAX_CAPACITY)
+    return ASA_CAPACITY_TOO_LARGE;
+  if (_resize_metadata(map, capacity) != ASA_NONE)
+    return ASA_MALLOC_FAILED;
+  asa_unit_t *newMem = _allocate_buckets(map->_buckets, capacity);
   if (newMem == NULL)
     return ASA_MALLOC_FAILED;
   if (capacity > map->_capacity) {
-    for (int i = map->_capacity; i != capacity; i++) {
+    for (size_t i = map->_capacity; i != capacity; i++) {
       asa_unit_t *target = newMem + i;
       asa_unit_t nullunit = {._key = NULL, ._value = NULL};
       *target = nullunit;
@@ -221,35 +709,33 @@ asa_err_t asa_reserve_space(asa_t *const map, unsigned int capacity) {
 
   map->_buckets = newMem;
   map->_capacity = capacity;
+  if (capacity < map->_min_capacity)
+    map->_min_capacity = capacity;
 
-  if (bstr_resize(map->_used_buckets, _calculate_bitstr_size(capacity)) !=
-      BSTR_NO_ERROR) {
+  if (_bitmap_resize(&map->_used_buckets, capacity) != ASA_NONE)
+    return ASA_DATASTRUCTURE_CORRUPTED;
+  if (_bitmap_resize(&map->_dirty_buckets, capacity) != ASA_NONE)
     return ASA_DATASTRUCTURE_CORRUPTED;
-  }
   return ASA_NONE;
 }
 
-unsigned int asa_get_capacity(const asa_t *const map) { return map->_capacity; }
+size_t asa_get_capacity(const asa_t *const map) { return map->_capacity; }
 
-unsigned int asa_get_length(const asa_t *const map) {
-  return bstr_popcnt(map->_used_buckets);
+size_t asa_get_length(const asa_t *const map) {
+  return _bitmap_count(&map->_used_buckets);
 }
 
 void *asa_get_value_by_key(const asa_t *const map, const void *const key) {
-  int first_candidate = bstr_ffs(map->_used_buckets);
-  if (first_candidate == -1)
+  if (map->_groups != NULL)
     return NULL;
-
-  for (int i = first_candidate; i < map->_capacity; i++) {
-    asa_unit_t *candidate = map->_buckets + i;
-    if (map->_comperator(key, candidate->_key) == 0)
-      return candidate->_value;
-  }
-  return NULL;
+  ptrdiff_t index = _lookup_key(map, key);
+  if (index == -1)
+    return NULL;
+  return _get_unit_by_index(map, index)->_value;
 }
 
 asa_iterator_t asa_new_iterator(const asa_t *const map) {
-  return bstr_ffs(map->_used_buckets);
+  return _bitmap_next_set(&map->_used_buckets, 0);
 }
 
 asa_iterator_t asa_foreach(const asa_t *const map, void **key, void **value,
@@ -257,7 +743,9 @@ asa_iterator_t asa_foreach(const asa_t *const map, void **key, void **value,
 #ifdef DEBUG
   assert(map != NULL);
 #endif
-  asa_iterator_t next = bstr_next_set_bit(map->_used_buckets, offset);
+  if (offset < 0)
+    return -1;
+  asa_iterator_t next = _bitmap_next_set(&map->_used_buckets, offset);
   if (next == -1)
     return next;
 
@@ -267,3 +755,466 @@ asa_iterator_t asa_foreach(const asa_t *const map, void **key, void **value,
 
   return next + 1;
 }
+
+asa_err_t asa_merge(asa_t *const dst, const asa_t *const src,
+                    asa_merge_policy_t policy) {
+#ifdef DEBUG
+  assert(dst != NULL);
+  assert(src != NULL);
+#endif
+  if (dst->_groups != NULL || src->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  if (dst == src)
+    return ASA_NONE;
+  size_t *src_indices;
+  size_t src_length;
+  asa_err_t err = _get_sorted_indices(src, &src_indices, &src_length);
+  if (err != ASA_NONE)
+    return err;
+  err = _merge_sorted(dst, src, src_indices, src_length, policy);
+  free(src_indices);
+  return err;
+}
+
+asa_err_t asa_diff(const asa_t *const a, const asa_t *const b,
+                   asa_diff_f *callback, void *context) {
+#ifdef DEBUG
+  assert(a != NULL);
+  assert(b != NULL);
+  assert(callback != NULL);
+#endif
+  if (a->_groups != NULL || b->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  size_t *a_indices;
+  size_t a_length;
+  asa_err_t err = _get_sorted_indices(a, &a_indices, &a_length);
+  if (err != ASA_NONE)
+    return err;
+  size_t *b_indices;
+  size_t b_length;
+  err = _get_sorted_indices(b, &b_indices, &b_length);
+  if (err != ASA_NONE) {
+    free(a_indices);
+    return err;
+  }
+
+  size_t i = 0;
+  size_t j = 0;
+  while (i != a_length || j != b_length) {
+    asa_unit_t *a_unit = i != a_length ? a->_buckets + a_indices[i] : NULL;
+    asa_unit_t *b_unit = j != b_length ? b->_buckets + b_indices[j] : NULL;
+    int cmp;
+    if (a_unit == NULL)
+      cmp = 1;
+    else if (b_unit == NULL)
+      cmp = -1;
+    else
+      cmp = a->_comperator(a_unit->_key, b_unit->_key);
+
+    if (cmp == 0) {
+      if (a_unit->_value != b_unit->_value)
+        callback(a_unit->_key, a_unit->_value, b_unit->_value,
+                 ASA_DIFF_CHANGED, context);
+      i++;
+      j++;
+    } else if (cmp < 0) {
+      callback(a_unit->_key, a_unit->_value, NULL, ASA_DIFF_ONLY_IN_A,
+               context);
+      i++;
+    } else {
+      callback(b_unit->_key, NULL, b_unit->_value, ASA_DIFF_ONLY_IN_B,
+               context);
+      j++;
+    }
+  }
+  free(a_indices);
+  free(b_indices);
+  return ASA_NONE;
+}
+
+asa_err_t asa_intersect(const asa_t *const a, const asa_t *const b,
+                        asa_t *const out) {
+#ifdef DEBUG
+  assert(a != NULL);
+  assert(b != NULL);
+  assert(out != NULL);
+  assert(out != a && out != b);
+#endif
+  if (a->_groups != NULL || b->_groups != NULL || out->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  size_t *a_indices;
+  size_t a_length;
+  asa_err_t err = _get_sorted_indices(a, &a_indices, &a_length);
+  if (err != ASA_NONE)
+    return err;
+  size_t *b_indices;
+  size_t b_length;
+  err = _get_sorted_indices(b, &b_indices, &b_length);
+  if (err != ASA_NONE) {
+    free(a_indices);
+    return err;
+  }
+
+  size_t common = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i != a_length && j != b_length) {
+    int cmp = a->_comperator(a->_buckets[a_indices[i]]._key,
+                             b->_buckets[b_indices[j]]._key);
+    if (cmp == 0) {
+      a_indices[common++] = a_indices[i++];
+      j++;
+    } else if (cmp < 0) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  free(b_indices);
+  err = _merge_sorted(out, a, a_indices, common, ASA_MERGE_OVERWRITE);
+  free(a_indices);
+  return err;
+}
+
+asa_err_t asa_upsert_many(asa_t *const map, void *const *keys,
+                          void *const *values, size_t n, asa_err_t *results) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  if (map->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  if (n == 0)
+    return ASA_NONE;
+  size_t *order;
+  size_t *begins;
+  size_t groups;
+  asa_err_t err = _group_batch((const void *const *)keys, n, map->_comperator,
+                               &order, &begins, &groups);
+  if (err != ASA_NONE)
+    return err;
+  bool *found = (bool *)calloc(groups, sizeof(bool));
+  asa_unit_t *pending = (asa_unit_t *)malloc(sizeof(asa_unit_t) * groups);
+  if (found == NULL || pending == NULL) {
+    free(found);
+    free(pending);
+    free(order);
+    free(begins);
+    return ASA_MALLOC_FAILED;
+  }
+
+  for (ptrdiff_t i = _bitmap_next_set(&map->_used_buckets, 0); i != -1;
+       i = _bitmap_next_set(&map->_used_buckets, i + 1)) {
+    ptrdiff_t group =
+        _find_group((const void *const *)keys, order, begins, groups,
+                    map->_buckets[i]._key, map->_comperator);
+    if (group == -1)
+      continue;
+    _set_value(map, i, values[order[begins[group + 1] - 1]]);
+    found[group] = true;
+  }
+
+  size_t pending_length = 0;
+  for (size_t group = 0; group != groups; group++) {
+    if (found[group])
+      continue;
+    asa_unit_t entry = {._key = keys[order[begins[group]]],
+                        ._value = values[order[begins[group + 1] - 1]]};
+    pending[pending_length++] = entry;
+  }
+  err = _append_units(map, pending, NULL, pending_length);
+
+  if (results != NULL) {
+    for (size_t group = 0; group != groups; group++) {
+      for (size_t k = begins[group]; k != begins[group + 1]; k++)
+        results[order[k]] = found[group] ? ASA_NONE : err;
+    }
+  }
+  free(found);
+  free(pending);
+  free(order);
+  free(begins);
+  return err;
+}
+
+asa_err_t asa_remove_many(asa_t *const map, const void *const *keys,
+                          size_t n, asa_err_t *results) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  if (n == 0)
+    return ASA_NONE;
+  size_t *order;
+  size_t *begins;
+  size_t groups;
+  asa_err_t err =
+      _group_batch(keys, n, map->_comperator, &order, &begins, &groups);
+  if (err != ASA_NONE)
+    return err;
+  bool *found = (bool *)calloc(groups, sizeof(bool));
+  if (found == NULL) {
+    free(order);
+    free(begins);
+    return ASA_MALLOC_FAILED;
+  }
+
+  for (ptrdiff_t i = _bitmap_next_set(&map->_used_buckets, 0); i != -1;
+       i = _bitmap_next_set(&map->_used_buckets, i + 1)) {
+    ptrdiff_t group = _find_group(keys, order, begins, groups,
+                                  map->_buckets[i]._key, map->_comperator);
+    if (group == -1)
+      continue;
+    _clear_bucket(map, i);
+    found[group] = true;
+  }
+
+  if (results != NULL) {
+    for (size_t group = 0; group != groups; group++) {
+      for (size_t k = begins[group]; k != begins[group + 1]; k++)
+        results[order[k]] = found[group] && k == begins[group]
+                                ? ASA_NONE
+                                : ASA_KEY_NOT_FOUND;
+    }
+  }
+  free(found);
+  free(order);
+  free(begins);
+  return ASA_NONE;
+}
+
+typedef struct _ranked_unit_t {
+  asa_unit_t unit;
+  uint32_t hits;
+  asa_group_t group;
+  size_t index;
+} _ranked_unit_t;
+
+static int _compare_ranked_units(const void *aptr, const void *bptr) {
+  const _ranked_unit_t *a = (const _ranked_unit_t *)aptr;
+  const _ranked_unit_t *b = (const _ranked_unit_t *)bptr;
+  if (a->hits != b->hits)
+    return a->hits > b->hits ? -1 : 1;
+  if (a->index != b->index)
+    return a->index < b->index ? -1 : 1;
+  return 0;
+}
+
+asa_err_t asa_set_adaptive(asa_t *const map, bool enabled) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  if (!enabled) {
+    free(map->_hits);
+    map->_hits = NULL;
+    return ASA_NONE;
+  }
+  if (map->_hits != NULL)
+    return ASA_NONE;
+  if (map->_capacity > SIZE_MAX / sizeof(uint32_t))
+    return ASA_MALLOC_FAILED;
+  map->_hits = (uint32_t *)calloc(map->_capacity + 1, sizeof(uint32_t));
+  if (map->_hits == NULL)
+    return ASA_MALLOC_FAILED;
+  return ASA_NONE;
+}
+
+asa_err_t asa_reorder(asa_t *const map) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  if (map->_hits == NULL)
+    return ASA_NONE;
+  size_t length = asa_get_length(map);
+  _ranked_unit_t *ranked =
+      (_ranked_unit_t *)malloc(sizeof(_ranked_unit_t) * (length + 1));
+  if (ranked == NULL)
+    return ASA_MALLOC_FAILED;
+
+  size_t count = 0;
+  for (ptrdiff_t i = _bitmap_next_set(&map->_used_buckets, 0); i != -1;
+       i = _bitmap_next_set(&map->_used_buckets, i + 1)) {
+    _ranked_unit_t entry = {
+        .unit = map->_buckets[i], .hits = map->_hits[i], .index = i};
+    if (map->_groups != NULL)
+      entry.group = map->_groups[i];
+    ranked[count++] = entry;
+  }
+  qsort(ranked, count, sizeof(_ranked_unit_t), &_compare_ranked_units);
+
+  // Only buckets whose entry changes are written, so entries that keep their
+  // place do not show up in the next checkpoint.
+  for (size_t i = 0; i != count; i++) {
+    map->_hits[i] = ranked[i].hits / 2;
+    if (ranked[i].index == i)
+      continue;
+    _set_bucket(map, i, ranked[i].unit);
+    if (map->_groups != NULL)
+      map->_groups[i] = ranked[i].group;
+  }
+  for (ptrdiff_t i = _bitmap_next_set(&map->_used_buckets, count); i != -1;
+       i = _bitmap_next_set(&map->_used_buckets, i + 1)) {
+    // The group moved to the front, it must not be counted as a hole.
+    if (map->_groups != NULL)
+      memset(map->_groups + i, 0, sizeof(asa_group_t));
+    _clear_bucket(map, i);
+  }
+  free(ranked);
+  return ASA_NONE;
+}
+
+double asa_get_average_probe_depth(const asa_t *const map) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  size_t depth = 0;
+  double depth_sum = 0;
+  double weighted_sum = 0;
+  double hit_sum = 0;
+  for (size_t i = 0; i != map->_capacity; i++) {
+    if (!_bitmap_get(&map->_used_buckets, i))
+      continue;
+    depth++;
+    depth_sum += depth;
+    if (map->_hits != NULL) {
+      weighted_sum += (double)map->_hits[i] * depth;
+      hit_sum += map->_hits[i];
+    }
+  }
+  if (hit_sum > 0)
+    return weighted_sum / hit_sum;
+  if (depth == 0)
+    return 0;
+  return depth_sum / depth;
+}
+
+asa_err_t asa_checkpoint_delta(asa_t *const map, asa_delta_writer_f *writer,
+                               void *context) {
+#ifdef DEBUG
+  assert(map != NULL);
+  assert(writer != NULL);
+#endif
+  if (map->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  asa_err_t err = ASA_NONE;
+  for (ptrdiff_t i = _bitmap_next_set(&map->_dirty_buckets, 0);
+       i != -1 && err == ASA_NONE;
+       i = _bitmap_next_set(&map->_dirty_buckets, i + 1)) {
+    asa_delta_t delta = {._index = i,
+                         ._used = _bitmap_get(&map->_used_buckets, i),
+                         ._key = map->_buckets[i]._key,
+                         ._value = map->_buckets[i]._value};
+    err = writer(&delta, context);
+  }
+  // Buckets cut off by a shrink are gone on the replica's side too, unless
+  // the map grew back and the dirty walk above already wrote them.
+  for (size_t i = map->_min_capacity;
+       i < map->_checkpoint_capacity && err == ASA_NONE; i++) {
+    if (i < map->_capacity && _bitmap_get(&map->_dirty_buckets, i))
+      continue;
+    asa_delta_t delta = {
+        ._index = i, ._used = false, ._key = NULL, ._value = NULL};
+    err = writer(&delta, context);
+  }
+  if (err != ASA_NONE)
+    return err;
+
+  _bitmap_clear_all(&map->_dirty_buckets);
+  map->_checkpoint_capacity = map->_capacity;
+  map->_min_capacity = map->_capacity;
+  return ASA_NONE;
+}
+
+asa_err_t asa_replay_delta(asa_t *const map, asa_delta_reader_f *reader,
+                           void *context) {
+#ifdef DEBUG
+  assert(map != NULL);
+  assert(reader != NULL);
+#endif
+  if (map->_groups != NULL)
+    return ASA_WRONG_MAP_TYPE;
+  asa_delta_t delta;
+  while (reader(&delta, context)) {
+    if (delta._index >= map->_capacity) {
+      if (!delta._used)
+        continue;
+      size_t capacity = map->_capacity * 2;
+      if (capacity > ASA_MAX_CAPACITY)
+        capacity = ASA_MAX_CAPACITY;
+      if (capacity <= delta._index)
+        capacity = delta._index + 1;
+      asa_err_t err = asa_reserve_space(map, capacity);
+      if (err != ASA_NONE)
+        return err;
+    }
+    if (delta._used) {
+      asa_unit_t entry = {._key = delta._key, ._value = delta._value};
+      _set_bucket(map, delta._index, entry);
+      if (map->_hits != NULL)
+        map->_hits[delta._index] = 0;
+    } else {
+      _clear_bucket(map, delta._index);
+    }
+  }
+  return ASA_NONE;
+}
+
+asa_err_t asa_multi_insert(asa_t *const map, void *const key,
+                           void *const value) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  if (map->_groups == NULL)
+    return ASA_WRONG_MAP_TYPE;
+  ptrdiff_t index = _lookup_key(map, key);
+  bool created = false;
+  if (index == -1) {
+    index = _bitmap_next_clear(&map->_used_buckets, 0);
+    if (index == -1)
+      return ASA_NO_SPACE_LEFT;
+    asa_unit_t entry = {._key = key, ._value = NULL};
+    _set_bucket(map, index, entry);
+    created = true;
+  }
+
+  asa_group_t *group = map->_groups + index;
+  if (group->_length == group->_capacity) {
+    asa_err_t err = _grow_group(map, index);
+    if (err != ASA_NONE) {
+      if (created)
+        _clear_bucket(map, index);
+      return err;
+    }
+  }
+  map->_arena[group->_offset + group->_length++] = value;
+  return ASA_NONE;
+}
+
+asa_err_t asa_multi_foreach_value(const asa_t *const map,
+                                  const void *const key, asa_value_f *callback,
+                                  void *context) {
+#ifdef DEBUG
+  assert(map != NULL);
+  assert(callback != NULL);
+#endif
+  if (map->_groups == NULL)
+    return ASA_WRONG_MAP_TYPE;
+  ptrdiff_t index = _lookup_key(map, key);
+  if (index == -1)
+    return ASA_KEY_NOT_FOUND;
+  const asa_group_t *group = map->_groups + index;
+  void *const *values = map->_arena + group->_offset;
+  for (size_t i = 0; i != group->_length; i++)
+    callback(values[i], context);
+  return ASA_NONE;
+}
+
+size_t asa_multi_count(const asa_t *const map, const void *const key) {
+#ifdef DEBUG
+  assert(map != NULL);
+#endif
+  if (map->_groups == NULL)
+    return 0;
+  ptrdiff_t index = _lookup_key(map, key);
+  if (index == -1)
+    return 0;
+  return map->_groups[index]._length;
+}
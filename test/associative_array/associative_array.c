@@ -33,6 +33,21 @@ void test_asa_create_map(void) {
   asa_delete_map(map);
 }
 
+void test_asa_capacity_limit(void) {
+  TEST_ASSERT_NULL(asa_create_map(SIZE_MAX, &asa_comperator_uint32_t));
+  TEST_ASSERT_NULL(
+      asa_create_map(ASA_MAX_CAPACITY + 1, &asa_comperator_uint32_t));
+
+  asa_t *map = asa_create_map(16, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  TEST_ASSERT_EQUAL_INT(ASA_CAPACITY_TOO_LARGE,
+                        asa_reserve_space(map, ASA_MAX_CAPACITY + 1));
+  TEST_ASSERT_EQUAL_INT(ASA_CAPACITY_TOO_LARGE,
+                        asa_reserve_space(map, SIZE_MAX));
+  TEST_ASSERT_EQUAL_UINT32(16, asa_get_capacity(map));
+  asa_delete_map(map);
+}
+
 void test_asa_insert(void) {
   asa_t *map = asa_create_map(16, &asa_comperator_uint32_t);
   TEST_ASSERT_NOT_NULL(map);
@@ -148,6 +163,33 @@ void test_asa_shrink_to_fit(void) {
   TEST_ASSERT_EQUAL_UINT32(1, asa_get_capacity(map));
 
   asa_delete_map(map);
+
+  // the used buckets span several bitmap words
+  map = asa_create_map(130, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  uint32_t keys[130];
+  uint32_t extra = 1000;
+  for (unsigned int i = 0; i < 130; i++) {
+    keys[i] = i;
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &keys[i], &val));
+  }
+  TEST_ASSERT_EQUAL_INT(ASA_NO_SPACE_LEFT, asa_insert(map, &extra, &val));
+  for (unsigned int i = 0; i < 129; i++)
+    if (i != 65)
+      TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_remove(map, &keys[i]));
+  TEST_ASSERT_EQUAL_UINT(2, asa_get_length(map));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_shrink_to_fit(map));
+  TEST_ASSERT_EQUAL_UINT(2, asa_get_capacity(map));
+  TEST_ASSERT_EQUAL_UINT(2, asa_get_length(map));
+  TEST_ASSERT_TRUE(asa_key_exists(map, &keys[65]));
+  TEST_ASSERT_TRUE(asa_key_exists(map, &keys[129]));
+  TEST_ASSERT_EQUAL_INT(ASA_NO_SPACE_LEFT, asa_insert(map, &extra, &val));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_reserve_space(map, 70));
+  TEST_ASSERT_EQUAL_UINT(2, asa_get_length(map));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &extra, &val));
+  TEST_ASSERT_EQUAL_UINT(3, asa_get_length(map));
+
+  asa_delete_map(map);
 }
 
 void test_asa_reserve_space(void) {
@@ -239,9 +281,373 @@ void test_asa_foreach(void) {
   asa_delete_map(map);
 }
 
+void test_asa_merge(void) {
+  asa_t *dst = asa_create_map(2, &asa_comperator_uint32_t);
+  asa_t *src = asa_create_map(4, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(dst);
+  TEST_ASSERT_NOT_NULL(src);
+  uint32_t keys[] = {1, 2, 3, 4};
+  uint32_t values[] = {10, 20, 30, 40};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(dst, &keys[0], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(dst, &keys[1], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(src, &keys[1], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(src, &keys[2], &values[2]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(src, &keys[3], &values[3]));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_merge(dst, src, ASA_MERGE_KEEP));
+  TEST_ASSERT_EQUAL_UINT(4, asa_get_length(dst));
+  TEST_ASSERT_EQUAL_UINT(4, asa_get_capacity(dst));
+  TEST_ASSERT_EQUAL_PTR(&values[0], asa_get_value_by_key(dst, &keys[1]));
+  TEST_ASSERT_EQUAL_PTR(&values[3], asa_get_value_by_key(dst, &keys[3]));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_merge(dst, src, ASA_MERGE_OVERWRITE));
+  TEST_ASSERT_EQUAL_UINT(4, asa_get_length(dst));
+  TEST_ASSERT_EQUAL_PTR(&values[0], asa_get_value_by_key(dst, &keys[0]));
+  TEST_ASSERT_EQUAL_PTR(&values[1], asa_get_value_by_key(dst, &keys[1]));
+
+  asa_delete_map(dst);
+  asa_delete_map(src);
+}
+
+static unsigned int diff_counts[3];
+
+static void count_diff(const void *key, void *a_value, void *b_value,
+                       asa_diff_kind_t kind, void *context) {
+  (void)key;
+  (void)a_value;
+  (void)b_value;
+  (void)context;
+  diff_counts[kind]++;
+}
+
+void test_asa_diff(void) {
+  asa_t *a = asa_create_map(4, &asa_comperator_uint32_t);
+  asa_t *b = asa_create_map(4, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  uint32_t keys[] = {1, 2, 3, 4};
+  uint32_t values[] = {10, 20};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &keys[0], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &keys[1], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &keys[2], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(b, &keys[1], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(b, &keys[2], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(b, &keys[3], &values[0]));
+
+  memset(diff_counts, 0, sizeof(diff_counts));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_diff(a, b, &count_diff, NULL));
+  TEST_ASSERT_EQUAL_UINT(1, diff_counts[ASA_DIFF_ONLY_IN_A]);
+  TEST_ASSERT_EQUAL_UINT(1, diff_counts[ASA_DIFF_ONLY_IN_B]);
+  TEST_ASSERT_EQUAL_UINT(1, diff_counts[ASA_DIFF_CHANGED]);
+
+
+  uint32_t more[] = {5, 6, 7, 8, 9, 10};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_reserve_space(a, 10));
+  for (unsigned int i = 0; i < 6; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &more[i], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_reserve_space(a, 3));
+  memset(diff_counts, 0, sizeof(diff_counts));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_diff(a, b, &count_diff, NULL));
+  TEST_ASSERT_EQUAL_UINT(1, diff_counts[ASA_DIFF_ONLY_IN_A]);
+  TEST_ASSERT_EQUAL_UINT(1, diff_counts[ASA_DIFF_ONLY_IN_B]);
+  TEST_ASSERT_EQUAL_UINT(1, diff_counts[ASA_DIFF_CHANGED]);
+
+  asa_delete_map(a);
+  asa_delete_map(b);
+}
+
+void test_asa_intersect(void) {
+  asa_t *a = asa_create_map(4, &asa_comperator_uint32_t);
+  asa_t *b = asa_create_map(4, &asa_comperator_uint32_t);
+  asa_t *out = asa_create_map(1, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_NOT_NULL(out);
+  uint32_t keys[] = {1, 2, 3, 4};
+  uint32_t values[] = {10, 20};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &keys[0], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &keys[1], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(a, &keys[2], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(b, &keys[3], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(b, &keys[2], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(b, &keys[1], &values[1]));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_intersect(a, b, out));
+  TEST_ASSERT_EQUAL_UINT(2, asa_get_length(out));
+  TEST_ASSERT_FALSE(asa_key_exists(out, &keys[0]));
+  TEST_ASSERT_EQUAL_PTR(&values[0], asa_get_value_by_key(out, &keys[1]));
+  TEST_ASSERT_EQUAL_PTR(&values[0], asa_get_value_by_key(out, &keys[2]));
+  TEST_ASSERT_FALSE(asa_key_exists(out, &keys[3]));
+
+  asa_delete_map(a);
+  asa_delete_map(b);
+  asa_delete_map(out);
+}
+
+void test_asa_upsert_many(void) {
+  asa_t *map = asa_create_map(2, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  uint32_t numbers[] = {5, 3, 7, 3, 9};
+  uint32_t values[] = {50, 30, 70, 31, 90};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &numbers[0], &values[1]));
+
+  void *keys[] = {&numbers[0], &numbers[1], &numbers[2], &numbers[3],
+                  &numbers[4]};
+  void *vals[] = {&values[0], &values[1], &values[2], &values[3], &values[4]};
+  asa_err_t results[5];
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_upsert_many(map, keys, vals, 5, results));
+  for (unsigned int i = 0; i < 5; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, results[i]);
+  TEST_ASSERT_EQUAL_UINT(4, asa_get_length(map));
+  TEST_ASSERT_EQUAL_UINT(4, asa_get_capacity(map));
+  TEST_ASSERT_EQUAL_PTR(&values[0], asa_get_value_by_key(map, &numbers[0]));
+  TEST_ASSERT_EQUAL_PTR(&values[3], asa_get_value_by_key(map, &numbers[1]));
+  TEST_ASSERT_EQUAL_PTR(&values[4], asa_get_value_by_key(map, &numbers[4]));
+  asa_delete_map(map);
+}
+
+void test_asa_remove_many(void) {
+  asa_t *map = asa_create_map(4, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  uint32_t numbers[] = {1, 2, 3, 4};
+  uint32_t val = 42;
+  for (unsigned int i = 0; i < 3; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &numbers[i], &val));
+
+  const void *keys[] = {&numbers[2], &numbers[3], &numbers[0], &numbers[2]};
+  asa_err_t results[4];
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_remove_many(map, keys, 4, results));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, results[0]);
+  TEST_ASSERT_EQUAL_INT(ASA_KEY_NOT_FOUND, results[1]);
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, results[2]);
+  TEST_ASSERT_EQUAL_INT(ASA_KEY_NOT_FOUND, results[3]);
+  TEST_ASSERT_EQUAL_UINT(1, asa_get_length(map));
+  TEST_ASSERT_TRUE(asa_key_exists(map, &numbers[1]));
+  asa_delete_map(map);
+}
+
+void test_asa_reorder(void) {
+  asa_t *map = asa_create_map(8, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  uint32_t keys[] = {0, 1, 2, 3, 4, 5, 6, 7};
+  uint32_t val = 42;
+  for (unsigned int i = 0; i < 8; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &keys[i], &val));
+  TEST_ASSERT_EQUAL_FLOAT(4.5, asa_get_average_probe_depth(map));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_set_adaptive(map, true));
+  for (unsigned int i = 0; i < 10; i++)
+    TEST_ASSERT_TRUE(asa_key_exists(map, &keys[7]));
+  for (unsigned int i = 0; i < 5; i++)
+    TEST_ASSERT_TRUE(asa_key_exists(map, &keys[6]));
+  TEST_ASSERT_TRUE(asa_get_average_probe_depth(map) > 7);
+
+  double depth = asa_get_average_probe_depth(map);
+  TEST_ASSERT_EQUAL_INT(ASA_DUPLICATE_KEY, asa_insert(map, &keys[0], &val));
+  TEST_ASSERT_EQUAL_FLOAT(depth, asa_get_average_probe_depth(map));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_reorder(map));
+  TEST_ASSERT_TRUE(asa_get_average_probe_depth(map) < 2);
+  TEST_ASSERT_EQUAL_UINT(8, asa_get_length(map));
+
+  uint32_t *test_key = NULL;
+  uint32_t *test_val = NULL;
+  asa_iterator_t it = asa_new_iterator(map);
+  it = asa_foreach(map, (void **)&test_key, (void **)&test_val, it);
+  TEST_ASSERT_EQUAL_PTR(&keys[7], test_key);
+  it = asa_foreach(map, (void **)&test_key, (void **)&test_val, it);
+  TEST_ASSERT_EQUAL_PTR(&keys[6], test_key);
+  it = asa_foreach(map, (void **)&test_key, (void **)&test_val, it);
+  TEST_ASSERT_EQUAL_PTR(&keys[0], test_key);
+
+  asa_delete_map(map);
+}
+
+typedef struct delta_log_t {
+  asa_delta_t deltas[128];
+  size_t length;
+  size_t position;
+} delta_log_t;
+
+static asa_err_t write_delta(const asa_delta_t *delta, void *context) {
+  delta_log_t *log = (delta_log_t *)context;
+  if (log->length == 128)
+    return ASA_NO_SPACE_LEFT;
+  log->deltas[log->length++] = *delta;
+  return ASA_NONE;
+}
+
+static bool read_delta(asa_delta_t *delta, void *context) {
+  delta_log_t *log = (delta_log_t *)context;
+  if (log->position == log->length)
+    return false;
+  *delta = log->deltas[log->position++];
+  return true;
+}
+
+void test_asa_checkpoint_delta(void) {
+  asa_t *map = asa_create_map(8, &asa_comperator_uint32_t);
+  asa_t *replica = asa_create_map(1, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  TEST_ASSERT_NOT_NULL(replica);
+  uint32_t keys[] = {1, 2, 3, 4};
+  uint32_t values[] = {10, 20};
+  for (unsigned int i = 0; i < 3; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &keys[i], &values[0]));
+
+  delta_log_t log = {.length = 0, .position = 0};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(3, log.length);
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_replay_delta(replica, &read_delta, &log));
+
+  log.length = 0;
+  log.position = 0;
+  TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(0, log.length);
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_update(map, &keys[0], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_remove(map, &keys[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(map, &keys[3], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(2, log.length);
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_replay_delta(replica, &read_delta, &log));
+
+  TEST_ASSERT_EQUAL_UINT(3, asa_get_length(replica));
+  TEST_ASSERT_EQUAL_PTR(&values[1], asa_get_value_by_key(replica, &keys[0]));
+  TEST_ASSERT_FALSE(asa_key_exists(replica, &keys[1]));
+  TEST_ASSERT_EQUAL_PTR(&values[0], asa_get_value_by_key(replica, &keys[2]));
+  TEST_ASSERT_EQUAL_PTR(&values[1], asa_get_value_by_key(replica, &keys[3]));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_set_adaptive(map, true));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_reorder(map));
+  log.length = 0;
+  log.position = 0;
+  TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(0, log.length);
+
+  asa_delete_map(map);
+  asa_delete_map(replica);
+
+  // a shrink followed by a regrow still removes the cut off buckets
+  map = asa_create_map(100, &asa_comperator_uint32_t);
+  replica = asa_create_map(1, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  TEST_ASSERT_NOT_NULL(replica);
+  uint32_t many_keys[60];
+  for (unsigned int i = 0; i < 60; i++) {
+    many_keys[i] = i;
+    TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                          asa_insert(map, &many_keys[i], &values[0]));
+  }
+  for (unsigned int i = 10; i < 50; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_remove(map, &many_keys[i]));
+  log.length = 0;
+  log.position = 0;
+  TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_replay_delta(replica, &read_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(20, asa_get_length(replica));
+
+  for (unsigned int i = 0; i < 10; i++)
+    TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_remove(map, &many_keys[i]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_shrink_to_fit(map));
+  TEST_ASSERT_EQUAL_UINT(10, asa_get_capacity(map));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_reserve_space(map, 100));
+  log.length = 0;
+  log.position = 0;
+  TEST_ASSERT_EQUAL_INT(ASA_NONE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_replay_delta(replica, &read_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(10, asa_get_length(replica));
+  for (unsigned int i = 0; i < 60; i++)
+    TEST_ASSERT_EQUAL_INT(i >= 50, asa_key_exists(replica, &many_keys[i]));
+
+  asa_delete_map(map);
+  asa_delete_map(replica);
+}
+
+static void collect_value(void *value, void *context) {
+  uint32_t ***cursor = (uint32_t ***)context;
+  **cursor = (uint32_t *)value;
+  (*cursor)++;
+}
+
+void test_asa_multimap(void) {
+  asa_t *map = asa_create_multimap(4, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(map);
+  uint32_t keys[] = {1, 2, 3};
+  uint32_t values[] = {10, 11, 12, 13, 20, 21};
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_insert(map, &keys[0], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_insert(map, &keys[1], &values[4]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_insert(map, &keys[0], &values[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_insert(map, &keys[1], &values[5]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_insert(map, &keys[0], &values[2]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_insert(map, &keys[0], &values[3]));
+  TEST_ASSERT_EQUAL_UINT(2, asa_get_length(map));
+  TEST_ASSERT_EQUAL_UINT(4, asa_multi_count(map, &keys[0]));
+  TEST_ASSERT_EQUAL_UINT(2, asa_multi_count(map, &keys[1]));
+  TEST_ASSERT_EQUAL_UINT(0, asa_multi_count(map, &keys[2]));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_remove(map, &keys[1]));
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_shrink_to_fit(map));
+  TEST_ASSERT_EQUAL_UINT(1, asa_get_capacity(map));
+
+  uint32_t *found[4] = {NULL, NULL, NULL, NULL};
+  uint32_t **cursor = found;
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_multi_foreach_value(map, &keys[0],
+                                                          &collect_value,
+                                                          &cursor));
+  for (unsigned int i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL_PTR(&values[i], found[i]);
+  TEST_ASSERT_EQUAL_INT(
+      ASA_KEY_NOT_FOUND,
+      asa_multi_foreach_value(map, &keys[1], &collect_value, &cursor));
+
+  asa_t *plain = asa_create_map(4, &asa_comperator_uint32_t);
+  TEST_ASSERT_NOT_NULL(plain);
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_merge(plain, map, ASA_MERGE_OVERWRITE));
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_merge(map, plain, ASA_MERGE_OVERWRITE));
+  void *batch[] = {&keys[2]};
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_upsert_many(map, batch, batch, 1, NULL));
+  delta_log_t log = {.length = 0, .position = 0};
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_checkpoint_delta(map, &write_delta, &log));
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_replay_delta(map, &read_delta, &log));
+  TEST_ASSERT_EQUAL_UINT(4, asa_multi_count(map, &keys[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_insert(map, &keys[2], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_upsert(map, &keys[0], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_update(map, &keys[0], &values[0]));
+  TEST_ASSERT_NULL(asa_get_value_by_key(map, &keys[0]));
+  TEST_ASSERT_FALSE(asa_key_exists(map, &keys[2]));
+  TEST_ASSERT_EQUAL_UINT(4, asa_multi_count(map, &keys[0]));
+
+  TEST_ASSERT_EQUAL_INT(ASA_NONE, asa_insert(plain, &keys[0], &values[0]));
+  TEST_ASSERT_EQUAL_INT(ASA_WRONG_MAP_TYPE,
+                        asa_multi_insert(plain, &keys[0], &values[1]));
+  TEST_ASSERT_EQUAL_INT(
+      ASA_WRONG_MAP_TYPE,
+      asa_multi_foreach_value(plain, &keys[0], &collect_value, &cursor));
+  TEST_ASSERT_EQUAL_UINT(0, asa_multi_count(plain, &keys[0]));
+  asa_delete_map(plain);
+
+  asa_delete_map(map);
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_asa_create_map);
+  RUN_TEST(test_asa_capacity_limit);
   RUN_TEST(test_asa_insert);
   RUN_TEST(test_asa_upsert);
   RUN_TEST(test_asa_update);
@@ -254,5 +660,13 @@ int main(void) {
   RUN_TEST(test_asa_get_length);
   RUN_TEST(test_asa_get_value_by_key);
   RUN_TEST(test_asa_foreach);
+  RUN_TEST(test_asa_merge);
+  RUN_TEST(test_asa_diff);
+  RUN_TEST(test_asa_intersect);
+  RUN_TEST(test_asa_upsert_many);
+  RUN_TEST(test_asa_remove_many);
+  RUN_TEST(test_asa_reorder);
+  RUN_TEST(test_asa_checkpoint_delta);
+  RUN_TEST(test_asa_multimap);
   UNITY_END();
 }